@@ -3,6 +3,12 @@
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <string>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <climits>
 
 using namespace std;
 
@@ -36,6 +42,415 @@ void writeMatrix(const string& filename, const vector<vector<double>>& matrix) {
     }
 }
 
+// Helper to multiply a block of rows of A by B (row-major, flattened)
+void multiplyRows(const vector<double>& localA, const vector<double>& flatB, vector<double>& localC,
+                  int local_rows, int A_cols, int B_cols) {
+    for (int i = 0; i < local_rows; ++i) {
+        for (int j = 0; j < B_cols; ++j) {
+            for (int k = 0; k < A_cols; ++k) {
+                localC[i * B_cols + j] += localA[i * A_cols + k] * flatB[k * B_cols + j];
+            }
+        }
+    }
+}
+
+// Shortest timing trusted as a throughput measurement, for calibration and profile updates
+const double MIN_TIMING_SECONDS = 0.02;
+
+// Weight of a new measurement when blended into a stored profile value
+const double PROFILE_SMOOTHING = 0.25;
+
+// Time a short multiply of n x n matrices and return the throughput in flop/s
+double calibrateThroughput(int n = 64, double min_seconds = MIN_TIMING_SECONDS) {
+    vector<double> a(n * n, 1.0), b(n * n, 0.5), c(n * n);
+    static volatile double sink = 0.0;
+
+    int reps = 0;
+    double start = MPI_Wtime(), elapsed = 0.0;
+    do {
+        fill(c.begin(), c.end(), 0.0);
+        multiplyRows(a, b, c, n, n, n);
+        sink = sink + c[reps % (n * n)];
+        ++reps;
+        elapsed = MPI_Wtime() - start;
+    } while (elapsed < min_seconds);
+
+    return 2.0 * n * n * n * reps / elapsed;
+}
+
+// Throughput of one host: flop/s observed on real problems and flop/s of the
+// calibration multiply, so calibrated-only hosts can be put on the same scale
+struct HostProfile {
+    double observed = 0.0, calibrated = 0.0;
+};
+
+// Helper to read a per-host throughput profile ("hostname observed calibrated" per line)
+map<string, HostProfile> readProfile(const string& filename) {
+    ifstream file(filename);
+    map<string, HostProfile> profile;
+    string line;
+    while (getline(file, line)) {
+        stringstream ss(line);
+        string host;
+        HostProfile entry;
+        if (ss >> host >> entry.observed >> entry.calibrated && entry.observed > 0 && entry.calibrated > 0)
+            profile[host] = entry;
+    }
+    return profile;
+}
+
+// Helper to write a per-host throughput profile
+void writeProfile(const string& filename, const map<string, HostProfile>& profile) {
+    ofstream file(filename);
+    for (const auto& entry : profile)
+        file << entry.first << " " << entry.second.observed << " " << entry.second.calibrated << "\n";
+}
+
+// Split total_rows in proportion to weights (largest remainder), so that
+// faster ranks receive more rows. Equal weights give the plain even split.
+vector<int> partitionRows(int total_rows, const vector<double>& weights) {
+    int n = weights.size();
+    double weight_sum = accumulate(weights.begin(), weights.end(), 0.0);
+
+    vector<int> rows(n);
+    vector<pair<double, int>> fractions(n);
+    int assigned = 0;
+    for (int i = 0; i < n; ++i) {
+        double share = total_rows * weights[i] / weight_sum;
+        rows[i] = static_cast<int>(floor(share));
+        fractions[i] = {share - rows[i], i};
+        assigned += rows[i];
+    }
+
+    // Hand out the leftover rows to the largest fractional shares, lowest rank first on ties
+    stable_sort(fractions.begin(), fractions.end(),
+                [](const pair<double, int>& a, const pair<double, int>& b) { return a.first > b.first; });
+    for (int i = 0; assigned < total_rows; i = (i + 1) % n, ++assigned)
+        rows[fractions[i].second]++;
+
+    return rows;
+}
+
+// Scatter rows [row_start, row_start + sum(rows)) of A, multiply them locally and gather
+// the corresponding rows of C on root. Returns the local compute time in seconds.
+double multiplyPhase(const vector<double>& flatA, const vector<double>& flatB, vector<double>& flatC,
+                     int row_start, const vector<int>& rows, int A_cols, int B_cols, int rank) {
+    int size = rows.size();
+    int local_rows = rows[rank];
+
+    vector<int> sendcounts(size), displs(size), recvcounts(size), rdispls(size);
+    int offset = 0;
+    for (int i = 0; i < size; ++i) {
+        sendcounts[i] = rows[i] * A_cols;
+        displs[i] = (row_start + offset) * A_cols;
+        recvcounts[i] = rows[i] * B_cols;
+        rdispls[i] = (row_start + offset) * B_cols;
+        offset += rows[i];
+    }
+
+    vector<double> localA(local_rows * A_cols);
+    MPI_Scatterv(rank == 0 ? flatA.data() : nullptr, sendcounts.data(), displs.data(), MPI_DOUBLE,
+                 localA.data(), local_rows * A_cols, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    vector<double> localC(local_rows * B_cols, 0);
+    double start = MPI_Wtime();
+    multiplyRows(localA, flatB, localC, local_rows, A_cols, B_cols);
+    double elapsed = MPI_Wtime() - start;
+
+    MPI_Gatherv(localC.data(), local_rows * B_cols, MPI_DOUBLE,
+                rank == 0 ? flatC.data() : nullptr, recvcounts.data(), rdispls.data(), MPI_DOUBLE,
+                0, MPI_COMM_WORLD);
+
+    return elapsed;
+}
+
+// Load imbalance of a set of per-rank times: max / mean - 1 (0 means perfectly balanced)
+double loadImbalance(const vector<double>& times) {
+    double mean = accumulate(times.begin(), times.end(), 0.0) / times.size();
+    double worst = *max_element(times.begin(), times.end());
+    return mean > 0 ? worst / mean - 1.0 : 0.0;
+}
+
+// One pair of a batch: A is M x K, B is K x N, both row-major
+struct MatrixPair {
+    int M, K, N;
+    vector<double> A, B;
+};
+
+// Largest dimension accepted in a batch file. Batches are meant for small matrices,
+// and this keeps every per-pair element count well inside int.
+const int MAX_BATCH_DIM = 4096;
+
+// Helper to read a batch file: each pair is a "M K N" header followed by the
+// M*K values of A and the K*N values of B (any whitespace layout).
+// An empty file is an error.
+bool readBatch(const string& filename, vector<MatrixPair>& pairs) {
+    ifstream file(filename);
+    if (!file) return false;
+
+    MatrixPair pair;
+    while (file >> pair.M) {
+        // A header cut short at end of file is an error, not the end of the batch
+        if (!(file >> pair.K >> pair.N)) return false;
+        if (pair.M <= 0 || pair.K <= 0 || pair.N <= 0) return false;
+        if (pair.M > MAX_BATCH_DIM || pair.K > MAX_BATCH_DIM || pair.N > MAX_BATCH_DIM) return false;
+        pair.A.resize(pair.M * pair.K);
+        pair.B.resize(pair.K * pair.N);
+        for (double& val : pair.A) if (!(file >> val)) return false;
+        for (double& val : pair.B) if (!(file >> val)) return false;
+        pairs.push_back(pair);
+    }
+    return file.eof() && !pairs.empty();
+}
+
+// Helper to write all batch results, each as an "M N" header followed by its rows
+void writeBatch(const string& filename, const vector<MatrixPair>& pairs,
+                const vector<double>& flatC, const vector<int>& c_offsets) {
+    ofstream file(filename);
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        file << pairs[p].M << " " << pairs[p].N << "\n";
+        for (int i = 0; i < pairs[p].M; ++i) {
+            for (int j = 0; j < pairs[p].N; ++j)
+                file << flatC[c_offsets[p] + i * pairs[p].N + j] << " ";
+            file << "\n";
+        }
+    }
+}
+
+// Assign whole pairs to ranks, largest flop count first, each to the rank that
+// would finish it soonest given its throughput weight
+vector<int> assignPairs(const vector<MatrixPair>& pairs, const vector<double>& weights) {
+    vector<int> order(pairs.size());
+    iota(order.begin(), order.end(), 0);
+    auto flops = [&](int p) { return 2.0 * pairs[p].M * pairs[p].K * pairs[p].N; };
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return flops(a) > flops(b); });
+
+    vector<double> finish(weights.size(), 0.0);
+    vector<int> owner(pairs.size());
+    for (int p : order) {
+        int best = 0;
+        for (size_t r = 1; r < weights.size(); ++r)
+            if (finish[r] + flops(p) / weights[r] < finish[best] + flops(p) / weights[best]) best = r;
+        finish[best] += flops(p) / weights[best];
+        owner[p] = best;
+    }
+    return owner;
+}
+
+// Number of same-size pairs interleaved together. Chunk buffers are then sized by
+// a handful of pairs rather than the whole group, and pack, multiply and unpack
+// touch the same cache-resident data for the small sizes batches are meant for.
+const int BATCH_WIDTH = 8;
+
+// Multiply BATCH_WIDTH D x D pairs stored interleaved: element e of pair p lives at
+// [e * BATCH_WIDTH + p], so the innermost loop runs across the chunk with unit stride.
+// B is packed transposed (element (j, k) at e = j * D + k) so both operands are
+// read contiguously along k.
+template <int D>
+void multiplyInterleaved(const double* A, const double* Bt, double* C) {
+    for (int i = 0; i < D; ++i) {
+        const double* a_row = A + i * D * BATCH_WIDTH;
+        for (int j = 0; j < D; ++j) {
+            const double* b_row = Bt + j * D * BATCH_WIDTH;
+            // One accumulator per pair of the chunk, kept in registers across k
+            double acc[BATCH_WIDTH] = {0};
+            for (int k = 0; k < D; ++k)
+#pragma GCC unroll 8
+                for (int p = 0; p < BATCH_WIDTH; ++p)
+                    acc[p] += a_row[k * BATCH_WIDTH + p] * b_row[k * BATCH_WIDTH + p];
+            for (int p = 0; p < BATCH_WIDTH; ++p)
+                C[(i * D + j) * BATCH_WIDTH + p] = acc[p];
+        }
+    }
+}
+
+typedef void (*InterleavedKernel)(const double*, const double*, double*);
+
+// Size-specialized kernel for a square dimension, or nullptr if there is none.
+// Every multiple of 8 from 8 to 128 is specialized; other sizes take the generic path.
+InterleavedKernel interleavedKernel(int dim) {
+    switch (dim) {
+        case 8:   return multiplyInterleaved<8>;
+        case 16:  return multiplyInterleaved<16>;
+        case 24:  return multiplyInterleaved<24>;
+        case 32:  return multiplyInterleaved<32>;
+        case 40:  return multiplyInterleaved<40>;
+        case 48:  return multiplyInterleaved<48>;
+        case 56:  return multiplyInterleaved<56>;
+        case 64:  return multiplyInterleaved<64>;
+        case 72:  return multiplyInterleaved<72>;
+        case 80:  return multiplyInterleaved<80>;
+        case 88:  return multiplyInterleaved<88>;
+        case 96:  return multiplyInterleaved<96>;
+        case 104: return multiplyInterleaved<104>;
+        case 112: return multiplyInterleaved<112>;
+        case 120: return multiplyInterleaved<120>;
+        case 128: return multiplyInterleaved<128>;
+        default:  return nullptr;
+    }
+}
+
+// Multiply the pairs held by this rank. dims holds M, K, N per pair and data holds
+// each pair's A followed by its B; results are written back-to-back into localC.
+void multiplyLocalBatch(const vector<int>& dims, const vector<double>& data, vector<double>& localC) {
+    int count = dims.size() / 3;
+    vector<int> in_offsets(count), out_offsets(count);
+    map<int, vector<int>> square_groups;
+    int in_offset = 0, out_offset = 0;
+    for (int p = 0; p < count; ++p) {
+        int M = dims[3 * p], K = dims[3 * p + 1], N = dims[3 * p + 2];
+        in_offsets[p] = in_offset;
+        out_offsets[p] = out_offset;
+        in_offset += M * K + K * N;
+        out_offset += M * N;
+        if (M == K && K == N) square_groups[M].push_back(p);
+        else square_groups[-1 - p].push_back(p); // no square kernel, keep on its own
+    }
+    localC.assign(out_offset, 0.0);
+
+    for (const auto& group : square_groups) {
+        int dim = group.first;
+        const vector<int>& members = group.second;
+        int n = members.size();
+
+        InterleavedKernel kernel = dim > 0 && n > 1 ? interleavedKernel(dim) : nullptr;
+        if (kernel) {
+            // Pack same-size pairs BATCH_WIDTH at a time into the interleaved layout,
+            // multiply, unpack; a short last chunk is padded with zero pairs.
+            // Loops run element-major so the chunk buffers are written and read contiguously.
+            int elems = dim * dim;
+            vector<double> A(elems * BATCH_WIDTH), B(elems * BATCH_WIDTH), C(elems * BATCH_WIDTH);
+            vector<double> zeros(2 * elems, 0.0);
+            const double* src[BATCH_WIDTH];
+            for (int start = 0; start < n; start += BATCH_WIDTH) {
+                int width = min(BATCH_WIDTH, n - start);
+                for (int b = 0; b < BATCH_WIDTH; ++b)
+                    src[b] = b < width ? &data[in_offsets[members[start + b]]] : zeros.data();
+
+                for (int e = 0; e < elems; ++e)
+                    for (int b = 0; b < BATCH_WIDTH; ++b)
+                        A[e * BATCH_WIDTH + b] = src[b][e];
+                for (int j = 0; j < dim; ++j)
+                    for (int k = 0; k < dim; ++k)
+                        for (int b = 0; b < BATCH_WIDTH; ++b)
+                            B[(j * dim + k) * BATCH_WIDTH + b] = src[b][elems + k * dim + j];
+
+                kernel(A.data(), B.data(), C.data());
+
+                for (int e = 0; e < elems; ++e)
+                    for (int b = 0; b < width; ++b)
+                        localC[out_offsets[members[start + b]] + e] = C[e * BATCH_WIDTH + b];
+            }
+            continue;
+        }
+
+        // Generic path for sizes without a kernel and singleton groups
+        for (int p : members) {
+            int M = dims[3 * p], K = dims[3 * p + 1], N = dims[3 * p + 2];
+            vector<double> a(data.begin() + in_offsets[p], data.begin() + in_offsets[p] + M * K);
+            vector<double> b(data.begin() + in_offsets[p] + M * K, data.begin() + in_offsets[p] + M * K + K * N);
+            vector<double> c(M * N, 0.0);
+            multiplyRows(a, b, c, M, K, N);
+            copy(c.begin(), c.end(), localC.begin() + out_offsets[p]);
+        }
+    }
+}
+
+// Batched mode: root reads every pair from one file, whole pairs are balanced
+// across ranks by flop count, and all results come back in a single gather
+void runBatch(const string& filename, const vector<double>& weights, int rank, int size) {
+    vector<MatrixPair> pairs;
+    vector<int> owner, pair_counts(size), dim_counts(size), dim_displs(size),
+                data_counts(size), data_displs(size), result_counts(size), result_displs(size);
+    vector<int> all_dims;
+    vector<double> all_data;
+
+    if (rank == 0) {
+        if (!readBatch(filename, pairs)) {
+            cerr << "Could not read batch file " << filename << "\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        // Scatter and gather counts are int, so the whole batch must fit in one
+        long long total_data = 0, total_results = 0;
+        for (const MatrixPair& pair : pairs) {
+            total_data += pair.A.size() + pair.B.size();
+            total_results += 1LL * pair.M * pair.N;
+        }
+        if (total_data > INT_MAX || total_results > INT_MAX || 3LL * pairs.size() > INT_MAX) {
+            cerr << "Batch file " << filename << " is too large for a single scatter\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        owner = assignPairs(pairs, weights);
+
+        // Lay the pairs out rank by rank for the scatters
+        for (int r = 0; r < size; ++r) {
+            dim_displs[r] = all_dims.size();
+            data_displs[r] = all_data.size();
+            result_displs[r] = accumulate(result_counts.begin(), result_counts.begin() + r, 0);
+            for (size_t p = 0; p < pairs.size(); ++p) {
+                if (owner[p] != r) continue;
+                const MatrixPair& pair = pairs[p];
+                all_dims.insert(all_dims.end(), {pair.M, pair.K, pair.N});
+                all_data.insert(all_data.end(), pair.A.begin(), pair.A.end());
+                all_data.insert(all_data.end(), pair.B.begin(), pair.B.end());
+                pair_counts[r]++;
+                result_counts[r] += pair.M * pair.N;
+            }
+            dim_counts[r] = all_dims.size() - dim_displs[r];
+            data_counts[r] = all_data.size() - data_displs[r];
+        }
+    }
+
+    // Tell each rank how much it receives, then ship dimensions and values
+    int my_counts[2];
+    vector<int> counts_pairs(2 * size);
+    for (int r = 0; r < size; ++r) {
+        counts_pairs[2 * r] = dim_counts[r];
+        counts_pairs[2 * r + 1] = data_counts[r];
+    }
+    MPI_Scatter(counts_pairs.data(), 2, MPI_INT, my_counts, 2, MPI_INT, 0, MPI_COMM_WORLD);
+
+    vector<int> dims(my_counts[0]);
+    vector<double> data(my_counts[1]);
+    MPI_Scatterv(all_dims.data(), dim_counts.data(), dim_displs.data(), MPI_INT,
+                 dims.data(), my_counts[0], MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(all_data.data(), data_counts.data(), data_displs.data(), MPI_DOUBLE,
+                 data.data(), my_counts[1], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    vector<double> localC;
+    double start = MPI_Wtime();
+    multiplyLocalBatch(dims, data, localC);
+    double elapsed = MPI_Wtime() - start;
+
+    // Single gather of every result, rank by rank
+    vector<double> flatC;
+    if (rank == 0) flatC.resize(accumulate(result_counts.begin(), result_counts.end(), 0));
+    MPI_Gatherv(localC.data(), localC.size(), MPI_DOUBLE,
+                flatC.data(), result_counts.data(), result_displs.data(), MPI_DOUBLE,
+                0, MPI_COMM_WORLD);
+
+    vector<double> times(size);
+    MPI_Gather(&elapsed, 1, MPI_DOUBLE, times.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        // Map each pair back to where its result landed in rank order
+        vector<int> c_offsets(pairs.size()), next(result_displs);
+        for (size_t p = 0; p < pairs.size(); ++p) {
+            c_offsets[p] = next[owner[p]];
+            next[owner[p]] += pairs[p].M * pairs[p].N;
+        }
+
+        for (int r = 0; r < size; ++r)
+            cout << "Rank " << r << ": " << pair_counts[r] << " pairs, " << times[r] << " s\n";
+        cout << "Load imbalance (max/mean - 1): " << loadImbalance(times) << "\n";
+
+        writeBatch("batch_result.txt", pairs, flatC, c_offsets);
+        cout << "Batched multiplication of " << pairs.size()
+             << " pairs complete. Results written to batch_result.txt\n";
+    }
+}
+
 int main(int argc, char** argv) {
     MPI_Init(&argc, &argv);
 
@@ -43,6 +458,75 @@ int main(int argc, char** argv) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank); // rank of current process
     MPI_Comm_size(MPI_COMM_WORLD, &size); // total processes
 
+    // Options: --adaptive        size partitions by a calibration multiply on each rank
+    //          --profile <file>  reuse/update a per-host throughput profile (implies --adaptive)
+    //          --rebalance       re-measure after half the rows and repartition the rest
+    //          --batch <file>    multiply every pair in <file> instead of matrixA.txt x matrixB.txt
+    bool adaptive = false, rebalance = false;
+    string profile_file, batch_file;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--adaptive") adaptive = true;
+        else if (arg == "--rebalance") rebalance = true;
+        else if (arg == "--profile" && i + 1 < argc) { profile_file = argv[++i]; adaptive = true; }
+        else if (arg == "--batch" && i + 1 < argc) batch_file = argv[++i];
+        else {
+            if (rank == 0) cerr << "Usage: matmul [--adaptive] [--profile file] [--rebalance] [--batch file]\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    // Batch mode neither rebalances nor writes back a profile
+    if (!batch_file.empty() && (rebalance || !profile_file.empty())) {
+        if (rank == 0) cerr << "--batch cannot be combined with --rebalance or --profile\n";
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Per-rank throughput weights (flop/s); all ones means the plain even split
+    vector<double> weights(size, 1.0);
+    char host[MPI_MAX_PROCESSOR_NAME] = {0};
+    int host_len;
+    MPI_Get_processor_name(host, &host_len);
+    vector<char> hosts(size * MPI_MAX_PROCESSOR_NAME);
+    map<string, HostProfile> profile;
+    double my_calibrated = 0.0;
+
+    if (adaptive) {
+        // Look up each rank's host in the persisted profile; unknown hosts calibrate
+        MPI_Gather(host, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, hosts.data(), MPI_MAX_PROCESSOR_NAME, MPI_CHAR,
+                   0, MPI_COMM_WORLD);
+        vector<double> known(size, 0.0);
+        double scale = 1.0;
+        if (rank == 0 && !profile_file.empty()) {
+            profile = readProfile(profile_file);
+            for (int i = 0; i < size; ++i) {
+                auto it = profile.find(&hosts[i * MPI_MAX_PROCESSOR_NAME]);
+                if (it != profile.end()) known[i] = it->second.observed;
+            }
+
+            // Calibration runs in cache and overstates real throughput; scale it
+            // by the mean observed/calibrated ratio of the profiled hosts
+            if (!profile.empty()) {
+                double ratio_sum = 0.0;
+                for (const auto& entry : profile)
+                    ratio_sum += entry.second.observed / entry.second.calibrated;
+                scale = ratio_sum / profile.size();
+            }
+        }
+        MPI_Bcast(known.data(), size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Bcast(&scale, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+        if (known[rank] <= 0) my_calibrated = calibrateThroughput();
+        double my_flops = known[rank] > 0 ? known[rank] : my_calibrated * scale;
+        MPI_Allgather(&my_flops, 1, MPI_DOUBLE, weights.data(), 1, MPI_DOUBLE, MPI_COMM_WORLD);
+    }
+
+    // Batched mode: many small pairs from one file, whole pairs per rank
+    if (!batch_file.empty()) {
+        runBatch(batch_file, weights, rank, size);
+        MPI_Finalize();
+        return 0;
+    }
+
     int A_rows = 0, A_cols = 0, B_rows = 0, B_cols = 0;
     vector<vector<double>> A, B;
 
@@ -71,61 +555,111 @@ int main(int argc, char** argv) {
     flatB.resize(A_cols * B_cols);
     MPI_Bcast(flatB.data(), A_cols * B_cols, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
-    // Scatter rows of A
-    int rows_per_proc = A_rows / size;
-    int remainder = A_rows % size;
-    int local_rows = rows_per_proc + (rank < remainder ? 1 : 0);
-
-    vector<double> localA(local_rows * A_cols);
-    vector<int> sendcounts(size), displs(size);
+    vector<double> flatA, flatC;
     if (rank == 0) {
-        int offset = 0;
-        for (int i = 0; i < size; ++i) {
-            int rows = rows_per_proc + (i < remainder ? 1 : 0);
-            sendcounts[i] = rows * A_cols;
-            displs[i] = offset;
-            offset += rows * A_cols;
-        }
-
-        vector<double> flatA;
         for (const auto& row : A)
             flatA.insert(flatA.end(), row.begin(), row.end());
-
-        MPI_Scatterv(flatA.data(), sendcounts.data(), displs.data(), MPI_DOUBLE,
-                     localA.data(), local_rows * A_cols, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    } else {
-        MPI_Scatterv(nullptr, nullptr, nullptr, MPI_DOUBLE,
-                     localA.data(), local_rows * A_cols, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        flatC.resize(A_rows * B_cols);
     }
 
-    // Multiply local rows
-    vector<double> localC(local_rows * B_cols, 0);
-    for (int i = 0; i < local_rows; ++i) {
-        for (int j = 0; j < B_cols; ++j) {
-            for (int k = 0; k < A_cols; ++k) {
-                localC[i * B_cols + j] += localA[i * A_cols + k] * flatB[k * B_cols + j];
+    // Split the rows into one phase, or two when rebalancing mid-run
+    int first_phase_rows = (rebalance && A_rows >= 2 * size) ? A_rows / 2 : A_rows;
+    vector<int> rows(size), my_rows;
+    vector<double> my_times, ideal_times(size, 0.0);
+
+    for (int row_start = 0; row_start < A_rows; ) {
+        int phase_rows = row_start == 0 ? first_phase_rows : A_rows - row_start;
+
+        // Partition on root and broadcast, so every rank agrees on the split
+        if (rank == 0) rows = partitionRows(phase_rows, weights);
+        MPI_Bcast(rows.data(), size, MPI_INT, 0, MPI_COMM_WORLD);
+
+        double elapsed = multiplyPhase(flatA, flatB, flatC, row_start, rows, A_cols, B_cols, rank);
+        my_rows.push_back(rows[rank]);
+        my_times.push_back(elapsed);
+        // Predicted time with each rank's throughput taken as its share of the total,
+        // so phases split with unit weights and with measured flop/s add up on one scale
+        double weight_sum = accumulate(weights.begin(), weights.end(), 0.0);
+        for (int i = 0; i < size; ++i)
+            ideal_times[i] += 2.0 * rows[i] * A_cols * B_cols / (weights[i] / weight_sum);
+        row_start += phase_rows;
+
+        // Re-measure actual throughput from this phase for the next one
+        if (row_start < A_rows) {
+            double measured = rows[rank] > 0 && elapsed > 0 ? 2.0 * rows[rank] * A_cols * B_cols / elapsed : 0.0;
+            vector<double> measured_all(size);
+            MPI_Allgather(&measured, 1, MPI_DOUBLE, measured_all.data(), 1, MPI_DOUBLE, MPI_COMM_WORLD);
+
+            // Ranks without a usable measurement keep their old weight, rescaled by the
+            // mean measured/old ratio of the others so every weight is in flop/s
+            double ratio_sum = 0.0;
+            int ratio_count = 0;
+            for (int i = 0; i < size; ++i) {
+                if (measured_all[i] <= 0) continue;
+                ratio_sum += measured_all[i] / weights[i];
+                ratio_count++;
+            }
+            if (ratio_count > 0) {
+                for (int i = 0; i < size; ++i)
+                    weights[i] = measured_all[i] > 0 ? measured_all[i] : weights[i] * ratio_sum / ratio_count;
             }
         }
     }
 
-    // Gather results
-    vector<int> recvcounts(size), rdispls(size);
+    // Report achieved versus ideal load imbalance
+    double my_time = accumulate(my_times.begin(), my_times.end(), 0.0);
+    int my_total_rows = accumulate(my_rows.begin(), my_rows.end(), 0);
+    vector<double> times(size);
+    vector<int> total_rows(size);
+    MPI_Gather(&my_time, 1, MPI_DOUBLE, times.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gather(&my_total_rows, 1, MPI_INT, total_rows.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+
     if (rank == 0) {
-        int offset = 0;
-        for (int i = 0; i < size; ++i) {
-            int rows = rows_per_proc + (i < remainder ? 1 : 0);
-            recvcounts[i] = rows * B_cols;
-            rdispls[i] = offset;
-            offset += rows * B_cols;
-        }
+        for (int i = 0; i < size; ++i)
+            cout << "Rank " << i << ": " << total_rows[i] << " rows, " << times[i] << " s\n";
+        cout << "Load imbalance (max/mean - 1): achieved " << loadImbalance(times)
+             << ", ideal " << loadImbalance(ideal_times) << "\n";
     }
 
-    vector<double> flatC;
-    if (rank == 0) flatC.resize(A_rows * B_cols);
-
-    MPI_Gatherv(localC.data(), local_rows * B_cols, MPI_DOUBLE,
-                flatC.data(), recvcounts.data(), rdispls.data(), MPI_DOUBLE,
-                0, MPI_COMM_WORLD);
+    // Persist the throughput observed in this run for the next one
+    if (adaptive && !profile_file.empty()) {
+        // Runs too short to time reliably leave the stored value alone
+        double observed = my_time >= MIN_TIMING_SECONDS && my_total_rows > 0
+                              ? 2.0 * my_total_rows * A_cols * B_cols / my_time : 0.0;
+        vector<double> observed_all(size), calibrated_all(size);
+        MPI_Gather(&observed, 1, MPI_DOUBLE, observed_all.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Gather(&my_calibrated, 1, MPI_DOUBLE, calibrated_all.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            // Average over ranks sharing a host, then blend into the stored value
+            // (exponential moving average) so a single run cannot overwrite it;
+            // hosts that did not calibrate this run keep their stored calibration
+            map<string, HostProfile> sums;
+            map<string, pair<int, int>> counts;
+            for (int i = 0; i < size; ++i) {
+                string name = &hosts[i * MPI_MAX_PROCESSOR_NAME];
+                if (observed_all[i] > 0) {
+                    sums[name].observed += observed_all[i];
+                    counts[name].first++;
+                }
+                if (calibrated_all[i] > 0) {
+                    sums[name].calibrated += calibrated_all[i];
+                    counts[name].second++;
+                }
+            }
+            for (const auto& entry : sums) {
+                const pair<int, int>& count = counts[entry.first];
+                HostProfile& stored = profile[entry.first];
+                auto blend = [](double stored_value, double measured) {
+                    return stored_value > 0 ? (1.0 - PROFILE_SMOOTHING) * stored_value + PROFILE_SMOOTHING * measured
+                                            : measured;
+                };
+                if (count.first > 0) stored.observed = blend(stored.observed, entry.second.observed / count.first);
+                if (count.second > 0) stored.calibrated = blend(stored.calibrated, entry.second.calibrated / count.second);
+                if (stored.observed <= 0 || stored.calibrated <= 0) profile.erase(entry.first);
+            }
+            writeProfile(profile_file, profile);
+        }
+    }
 
     if (rank == 0) {
         vector<vector<double>> result(A_rows, vector<double>(B_cols));